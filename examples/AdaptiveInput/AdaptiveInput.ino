@@ -0,0 +1,73 @@
+// This example demonstrates the adaptive input scheduler.  While the inputs
+// are quiet they are serviced from the chip's INTA pin.  When they get busy
+// the scheduler switches to polling the port instead, and switches back to
+// interrupts when things calm down again.
+
+#include <MCP23S17.h>
+#include <MCP23S17Scheduler.h>
+#include <SPI.h>
+
+const uint8_t address = 0;
+const uint8_t interruptPinA = 2;
+const uint8_t chipSelectPin = 10;
+
+MCP23S17 mcp23s17(&SPI, chipSelectPin, address);
+MCP23S17Scheduler inputs(&mcp23s17);
+
+// All the ISR does is tell the scheduler an interrupt happened. The
+// port is read later from loop().
+void interruptA() {
+    inputs.handleInterrupt();
+}
+
+void inputChanged(uint16_t value, uint16_t changed) {
+    Serial.print("Changed: 0x");
+    Serial.print(changed, HEX);
+    Serial.print(" Value: 0x");
+    Serial.println(value, HEX);
+}
+
+void setup() {
+    Serial.begin(115200);
+    mcp23s17.begin();
+
+    for (uint8_t pin = 0; pin < 16; pin++) {
+        mcp23s17.pinMode(pin, INPUT_PULLUP);
+        mcp23s17.enableInterrupt(pin, CHANGE);
+    }
+    mcp23s17.setMirror(true);
+    mcp23s17.setInterruptOD(false);
+    mcp23s17.setInterruptLevel(LOW);
+
+    // Poll every 2ms once there are 30 or more changes in 100ms, and go
+    // back to interrupts when there are 5 or fewer changes in 100ms.
+    inputs.setThresholds(30, 5);
+    inputs.setPollInterval(2000);
+    inputs.begin(inputChanged);
+
+    pinMode(interruptPinA, INPUT_PULLUP);
+    attachInterrupt(digitalPinToInterrupt(interruptPinA), interruptA, FALLING);
+}
+
+void loop() {
+    static uint32_t lastReport = 0;
+
+    inputs.update();
+
+    if (millis() - lastReport >= 5000) {
+        lastReport = millis();
+        Serial.print(inputs.isPolling() ? "Polling" : "Interrupts");
+        Serial.print(" events: ");
+        Serial.print(inputs.getEventCount());
+        Serial.print(" reads: ");
+        Serial.print(inputs.getReadCount());
+        Serial.print(" avg latency: ");
+        Serial.print(inputs.getAverageLatency());
+        Serial.print("us max latency: ");
+        Serial.print(inputs.getMaxLatency());
+        Serial.print("us max poll gap: ");
+        Serial.print(inputs.getMaxPollGap());
+        Serial.print("us switches: ");
+        Serial.println(inputs.getModeSwitches());
+    }
+}
@@ -0,0 +1,49 @@
+// This example demonstrates how to use 8 MCP23S17 chips sharing one chip
+// select pin with the register mirrors pooled on an MCP23S17Bus, which
+// saves RAM when there are many chips.
+
+#include <MCP23S17.h>
+
+#ifdef __PIC32MX__
+// chipKIT uses the DSPI library instead of the SPI library as it's better
+#include <DSPI.h>
+DSPI0 SPI;
+#else
+// Everytying else uses the SPI library
+#include <SPI.h>
+#endif
+
+const uint8_t chipSelect = 10;
+
+// Storage for the register mirrors, one slot for each chip on the bus.
+uint8_t Pool[8][MCP23S17_SLOT_SIZE];
+
+// The bus holds the SPI object, chip select pin and the pool.
+MCP23S17Bus Bus(&SPI, chipSelect, Pool, 8);
+
+// Create an object for each chip on the bus, using addresses 0 to 7.
+MCP23S17Chip Bank[8] = {
+    MCP23S17Chip(&Bus, 0), MCP23S17Chip(&Bus, 1), MCP23S17Chip(&Bus, 2), MCP23S17Chip(&Bus, 3),
+    MCP23S17Chip(&Bus, 4), MCP23S17Chip(&Bus, 5), MCP23S17Chip(&Bus, 6), MCP23S17Chip(&Bus, 7)
+};
+
+void setup() {
+    Serial.begin(115200);
+    for (uint8_t i = 0; i < 8; i++) {
+        // begin() gives the chip its slot in the pool
+        if (!Bank[i].begin()) {
+            Serial.println("Not enough slots in the pool");
+        }
+        for (uint8_t pin = 0; pin < 8; pin++) {
+            Bank[i].pinMode(pin, INPUT_PULLUP);
+            Bank[i].pinMode(pin + 8, OUTPUT);
+        }
+    }
+}
+
+void loop() {
+    // Echo port A of each chip onto its port B
+    for (uint8_t i = 0; i < 8; i++) {
+        Bank[i].writePort(1, Bank[i].readPort(0));
+    }
+}
@@ -0,0 +1,42 @@
+// This example demonstrates keeping the chip's configuration in step with
+// the library by checking a small part of it on every pass through loop().
+
+#include <MCP23S17.h>
+
+#ifdef __PIC32MX__
+// chipKIT uses the DSPI library instead of the SPI library as it's better
+#include <DSPI.h>
+DSPI0 SPI;
+#else
+// Everytying else uses the SPI library
+#include <SPI.h>
+#endif
+
+const uint8_t chipSelect = 10;
+
+MCP23S17 Bank1(&SPI, chipSelect, 0);
+
+// Called whenever the chip is found to have been reset and has been
+// reinitialised from the library's copy of its registers.
+void expanderReset(MCP23S17 *chip) {
+    Serial.println("Expander was reset and has been restored");
+}
+
+void setup() {
+    Serial.begin(115200);
+    Bank1.begin();
+    Bank1.setResetCallback(expanderReset);
+
+    Bank1.pinMode(0, OUTPUT);
+    Bank1.pinMode(1, INPUT_PULLUP);
+}
+
+void loop() {
+    Bank1.digitalWrite(0, !Bank1.digitalRead(1));
+
+    // Check one register pair per pass and repair it if it has drifted
+    if (Bank1.verifyStep() > 0) {
+        Serial.print("Mismatches so far: ");
+        Serial.println(Bank1.getMismatchCount());
+    }
+}
@@ -30,183 +30,215 @@
 
 #include <MCP23S17.h>
 
-/*! The constructor takes three parameters.  The first is an SPI class
- *  pointer.  This is the address of an SPI object (either the default
- *  SPI object on the Arduino, or an object made using the DSPIx classes
- *  on the chipKIT).  The second parameter is the chip select pin number
- *  to use when communicating with the chip.  The third is the internal
- *  address number of the chip.  This is controlled by the three Ax pins
- *  on the chip.
- *  
- *  Example:
- *
- *      MCP23S17 myExpander(&SPI, 10, 0);
- * 
+#ifndef PROGMEM
+# define PROGMEM
+#endif
+#ifndef pgm_read_byte
+# define pgm_read_byte(p) (*(const uint8_t *)(p))
+#endif
+
+/*! Power-on values for a slot: the registers IODIRA to GPPUB at their own
+ *  addresses, followed by OLATA and OLATB.  IOCON has address-based communication
+ *  (HAEN) and slew rate control disabled (DISSLW) set, as configured by begin().
+ *  The IOCONB position holds the chip address, which initSlot() fills in.
  */
+static const uint8_t MCP23S17_defaults[MCP23S17_SLOT_SIZE] PROGMEM = {
+    0xFF, 0xFF,     // IODIR
+    0x00, 0x00,     // IPOL
+    0x00, 0x00,     // GPINTEN
+    0x00, 0x00,     // DEFVAL
+    0x00, 0x00,     // INTCON
+    0x18, 0x00,     // IOCON, chip address
+    0x00, 0x00,     // GPPU
+    0x00, 0x00      // OLAT
+};
+
 #ifdef __PIC32MX__
-MCP23S17::MCP23S17(DSPI *spi, uint8_t cs, uint8_t addr) {
+MCP23S17Base::MCP23S17Base(DSPI *spi, uint8_t cs) {
 #else
-MCP23S17::MCP23S17(SPIClass *spi, uint8_t cs, uint8_t addr) {
+MCP23S17Base::MCP23S17Base(SPIClass *spi, uint8_t cs) {
 #endif
     _spi = spi;
     _cs = cs;
-    _addr = addr;
-
-    _reg[MCP_IODIRA] = 0xFF;
-    _reg[MCP_IODIRB] = 0xFF;
-    _reg[MCP_IPOLA] = 0x00;
-    _reg[MCP_IPOLB] = 0x00;
-    _reg[MCP_GPINTENA] = 0x00;
-    _reg[MCP_GPINTENB] = 0x00;
-    _reg[MCP_DEFVALA] = 0x00;
-    _reg[MCP_DEFVALB] = 0x00;
-    _reg[MCP_INTCONA] = 0x00;
-    _reg[MCP_INTCONB] = 0x00;
-    _reg[MCP_IOCONA] = 0x18;
-    _reg[MCP_IOCONB] = 0x18;
-    _reg[MCP_GPPUA] = 0x00;
-    _reg[MCP_GPPUB] = 0x00;
-    _reg[MCP_INTFA] = 0x00;
-    _reg[MCP_INTFB] = 0x00;
-    _reg[MCP_INTCAPA] = 0x00;
-    _reg[MCP_INTCAPB] = 0x00;
-    _reg[MCP_GPIOA] = 0x00;
-    _reg[MCP_GPIOB] = 0x00;
-    _reg[MCP_OLATA] = 0x00;
-    _reg[MCP_OLATB] = 0x00;
+    _mismatches = 0;
 }
 
-#ifdef __PIC32MX__
-MCP23S17::MCP23S17(DSPI &spi, uint8_t cs, uint8_t addr) {
-#else
-MCP23S17::MCP23S17(SPIClass &spi, uint8_t cs, uint8_t addr) {
-#endif
-    _spi = &spi;
-    _cs = cs;
-    _addr = addr;
-
-    _reg[MCP_IODIRA] = 0xFF;
-    _reg[MCP_IODIRB] = 0xFF;
-    _reg[MCP_IPOLA] = 0x00;
-    _reg[MCP_IPOLB] = 0x00;
-    _reg[MCP_GPINTENA] = 0x00;
-    _reg[MCP_GPINTENB] = 0x00;
-    _reg[MCP_DEFVALA] = 0x00;
-    _reg[MCP_DEFVALB] = 0x00;
-    _reg[MCP_INTCONA] = 0x00;
-    _reg[MCP_INTCONB] = 0x00;
-    _reg[MCP_IOCONA] = 0x18;
-    _reg[MCP_IOCONB] = 0x18;
-    _reg[MCP_GPPUA] = 0x00;
-    _reg[MCP_GPPUB] = 0x00;
-    _reg[MCP_INTFA] = 0x00;
-    _reg[MCP_INTFB] = 0x00;
-    _reg[MCP_INTCAPA] = 0x00;
-    _reg[MCP_INTCAPB] = 0x00;
-    _reg[MCP_GPIOA] = 0x00;
-    _reg[MCP_GPIOB] = 0x00;
-    _reg[MCP_OLATA] = 0x00;
-    _reg[MCP_OLATB] = 0x00;
-}
-
-/*! The begin function performs the initial configuration of the IO expander chip.
- *  Not only does it set up the SPI communications, but it also configures the chip
- *  for address-based communication and sets the default parameters and registers
- *  to sensible values.
- *
- *  Example:
- *
- *      myExpander.begin();
- *
+/*! This private function loads a slot with the default register values from the
+ *  shared table and records the chip's address in it.
+ */
+void MCP23S17Base::initSlot(uint8_t *slot, uint8_t addr) {
+    for (uint8_t i = 0; i < MCP23S17_SLOT_SIZE; i++) {
+        slot[i] = pgm_read_byte(&MCP23S17_defaults[i]);
+    }
+    slot[SLOT_ADDR] = addr & 0b111;
+}
+
+/*! This private function selects the chips on the chip select line and sends the
+ *  opcode and register address that start every transfer.  The caller sends or
+ *  receives the data and then raises the chip select again.
+ */
+void MCP23S17Base::select(uint8_t cmd, uint8_t addr) {
+    ::digitalWrite(_cs, LOW);
+    _spi->transfer(cmd);
+    _spi->transfer(addr);
+}
+
+/*! This private function sets up the SPI communications and then configures the
+ *  chip whose mirror is in the given slot.  The iocon parameter is the IOCON value
+ *  to broadcast to address 0 while turning on address-based communication; see
+ *  enableAddressing().  Any offline flag left by verifyStep() is cleared.
  */
-void MCP23S17::begin() {
+void MCP23S17Base::beginChip(uint8_t *slot, uint8_t iocon) {
     _spi->begin();
     ::pinMode(_cs, OUTPUT);
     ::digitalWrite(_cs, HIGH);
-    uint8_t cmd = 0b01000000;
-    ::digitalWrite(_cs, LOW);
-    _spi->transfer(cmd);
-    _spi->transfer(MCP_IOCONA);
-    _spi->transfer(0x18);
+    enableAddressing(iocon);
+    writeAll(slot);
+    slot[SLOT_ADDR] &= ~SLOT_OFFLINE;
+}
+
+/*! This private function enables address-based communication (HAEN) on every chip
+ *  on the chip select line that does not already have it.  Such chips only answer
+ *  on address 0, so the IOCON value is written to address 0, which also reaches any
+ *  chip that really is at address 0.  The value given should therefore be that
+ *  chip's IOCON from its mirror where known, so its other IOCON settings survive.
+ *  It is used both by begin() and to recover chips that verifyStep() has found to
+ *  have been reset.
+ */
+void MCP23S17Base::enableAddressing(uint8_t iocon) {
+    select(0b01000000, MCP_IOCONA);
+    _spi->transfer(iocon | (1<<3));
     ::digitalWrite(_cs, HIGH);
-    writeAll();
 }
 
-/*! This private function reads a value from the specified register on the chip and
- *  stores it in the _reg array for later usage.
+/*! This private function reads IOCON back from the chip after it has been
+ *  reinitialised and checks it against the mirror.  If it does not match, the chip
+ *  is not answering (it is missing or unpowered) and is flagged as offline in its
+ *  slot so that verifyStep() does not keep trying to recover it.  It returns true
+ *  if the chip answered.
  */
-void MCP23S17::readRegister(uint8_t addr) {
-    if (addr > 21) {
-        return;
+boolean MCP23S17Base::responding(uint8_t *slot) {
+    if (readRegister(slot, MCP_IOCONA) == slot[MCP_IOCONA]) {
+        slot[SLOT_ADDR] &= ~SLOT_OFFLINE;
+        return true;
+    }
+    slot[SLOT_ADDR] |= SLOT_OFFLINE;
+    return false;
+}
+
+/*! This private function reads one register, or an A/B register pair in a single
+ *  transfer, from the chip and returns it, the second register of a pair in the
+ *  upper half.  The mirror is not changed.
+ */
+uint16_t MCP23S17Base::readRegisters(uint8_t *slot, uint8_t addr, uint8_t count) {
+    select(opcode(slot, 1), addr);
+    uint16_t val = _spi->transfer(0xFF);
+    if (count > 1) {
+        val |= _spi->transfer(0xFF) << 8;
     }
-    uint8_t cmd = 0b01000001 | ((_addr & 0b111) << 1);
-    ::digitalWrite(_cs, LOW);
-    _spi->transfer(cmd);
-    _spi->transfer(addr);
-    _reg[addr] = _spi->transfer(0xFF);
     ::digitalWrite(_cs, HIGH);
+    return val;
 }
 
 /*! This private function writes the current value of a register (as stored in the
- *  _reg array) out to the register in the chip.
+ *  mirror) out to the register in the chip.  Registers that are not mirrored are
+ *  ignored.
  */
-void MCP23S17::writeRegister(uint8_t addr) {
-    if (addr > 21) {
+void MCP23S17Base::writeRegister(uint8_t *slot, uint8_t addr) {
+    if ((addr == MCP_IOCONB) || ((addr > MCP_GPPUB) && (addr < MCP_OLATA)) || (addr > MCP_OLATB)) {
         return;
     }
-    uint8_t cmd = 0b01000000 | ((_addr & 0b111) << 1);
-    ::digitalWrite(_cs, LOW);
-    _spi->transfer(cmd);
-    _spi->transfer(addr);
-    _spi->transfer(_reg[addr]);
+    select(opcode(slot, 0), addr);
+    _spi->transfer(slot[index(addr)]);
     ::digitalWrite(_cs, HIGH);
 }
 
-/*! This private function performs a bulk read on all the registers in the chip to
- *  ensure the _reg array contains all the correct current values.
+/*! This private function performs a bulk write of all the data in the mirror out
+ *  to the registers on the chip.  It is mainly used during the initialisation
+ *  of the chip.  All 22 registers are written in one sequential transfer: IOCONB
+ *  gets the IOCON value, the read-only interrupt flag and capture registers ignore
+ *  what they are sent, and GPIO and OLAT are both sent the output latch values,
+ *  since writing GPIO sets OLAT.
  */
-void MCP23S17::readAll() {
-    uint8_t cmd = 0b01000001 | ((_addr & 0b111) << 1);
-    ::digitalWrite(_cs, LOW);
-    _spi->transfer(cmd);
-    _spi->transfer(0);
-    for (uint8_t i = 0; i < 22; i++) {
-        _reg[i] = _spi->transfer(0xFF);
+void MCP23S17Base::writeAll(uint8_t *slot) {
+    select(opcode(slot, 0), MCP_IODIRA);
+    for (uint8_t i = MCP_IODIRA; i <= MCP_OLATB; i++) {
+        uint8_t pos = i;
+        if (i == MCP_IOCONB) {
+            pos = MCP_IOCONA;
+        } else if (i > MCP_GPPUB) {
+            pos = index(MCP_OLATA) + (i & 1);
+        }
+        _spi->transfer(slot[pos]);
     }
     ::digitalWrite(_cs, HIGH);
 }
 
-/*! This private function performs a bulk write of all the data in the _reg array
- *  out to all the registers on the chip.  It is mainly used during the initialisation
- *  of the chip.
+/*! This private function reads back one A/B register pair of the chip and compares
+ *  it with the mirror, rewriting any register that differs.  It returns the number
+ *  of registers repaired, or VERIFY_RESET if IOCON shows that the chip has been
+ *  reset, in which case nothing is repaired.
+ *
+ *  A chip flagged as offline only has IOCON checked, and stays offline until IOCON
+ *  reads back exactly as mirrored.  Whether an absent chip reads as 0xFF or 0x00
+ *  depends on the board, so no other value is taken as the chip having returned.
  */
-void MCP23S17::writeAll() {
-    uint8_t cmd = 0b01000000 | ((_addr & 0b111) << 1);
-    ::digitalWrite(_cs, LOW);
-    _spi->transfer(cmd);
-    _spi->transfer(0);
-    for (uint8_t i = 0; i < 22; i++) {
-        _spi->transfer(_reg[i]);
+uint8_t MCP23S17Base::verifyRange(uint8_t *slot, uint8_t base) {
+    uint8_t val[2];
+    uint8_t bad = 0;
+
+    if ((slot[SLOT_ADDR] & SLOT_OFFLINE) && (base != MCP_IOCONA)) {
+        return 0;
     }
-    ::digitalWrite(_cs, HIGH);
+
+    uint16_t pair = readPair(slot, base);
+    val[0] = pair & 0xFF;
+    val[1] = pair >> 8;
+
+    if (base == MCP_IOCONA) {
+        if (slot[SLOT_ADDR] & SLOT_OFFLINE) {
+            if (val[0] != slot[MCP_IOCONA]) {
+                return 0;
+            }
+            slot[SLOT_ADDR] &= ~SLOT_OFFLINE;
+        } else if ((val[0] == 0xFF) || ((val[0] & (1<<3)) == 0)) {
+            _mismatches++;
+            return VERIFY_RESET;
+        }
+        // IOCONB is the same register, and its place in the slot holds the address.
+        val[1] = slot[MCP_IOCONB];
+    }
+
+    for (uint8_t i = 0; i < 2; i++) {
+        if (val[i] != slot[index(base + i)]) {
+            writeRegister(slot, base + i);
+            bad++;
+        }
+    }
+    _mismatches += bad;
+    return bad;
 }
-    
-/*! Just like the pinMode() function of the Arduino API, this function sets the
- *  direction of the pin.  The first parameter is the pin nimber (0-15) to use,
- *  and the second parameter is the direction of the pin.  There are standard
- *  Arduino macros for different modes which should be used.  The supported macros are:
- *
- *  * OUTPUT
- *  * INPUT
- *  * INPUT_PULLUP
- *
- *  The INPUT_PULLUP mode enables the weak pullup that is available on any pin.
- *
- *  Example:
- *
- *      myExpander.pinMode(5, INPUT_PULLUP);
+
+/*! This private function returns the first register of the range verifyStep()
+ *  checks after the one starting at base.  Each chip's cycle starts at IOCON, so a
+ *  reset or missing chip is found before any of its other registers are compared.
+ */
+uint8_t MCP23S17Base::nextRange(uint8_t base) {
+    base += 2;
+    if (base == MCP_INTFA) {
+        return MCP_OLATA;
+    }
+    if (base > MCP_OLATB) {
+        return MCP_IODIRA;
+    }
+    return base;
+}
+
+/*! The following functions do the work for the MCP23S17 and MCP23S17Chip functions
+ *  of the same names, which are documented with MCP23S17, on the chip whose mirror
+ *  is in the given slot.
  */
-void MCP23S17::pinMode(uint8_t pin, uint8_t mode) {
+void MCP23S17Base::pinMode(uint8_t *slot, uint8_t pin, uint8_t mode) {
     if (pin >= 16) {
         return;
     }
@@ -220,35 +252,25 @@ void MCP23S17::pinMode(uint8_t pin, uint8_t mode) {
 
     switch (mode) {
         case OUTPUT:
-            _reg[dirReg] &= ~(1<<pin);
-            writeRegister(dirReg);
+            slot[dirReg] &= ~(1<<pin);
+            writeRegister(slot, dirReg);
             break;
 
         case INPUT:
         case INPUT_PULLUP:
-            _reg[dirReg] |= (1<<pin);
-            writeRegister(dirReg);
+            slot[dirReg] |= (1<<pin);
+            writeRegister(slot, dirReg);
             if (mode == INPUT_PULLUP) {
-                _reg[puReg] |= (1<<pin);
+                slot[puReg] |= (1<<pin);
             } else {
-                _reg[puReg] &= ~(1<<pin);
+                slot[puReg] &= ~(1<<pin);
             }
-            writeRegister(puReg);
+            writeRegister(slot, puReg);
             break;
     }
 }
 
-/*! Like the Arduino API's namesake, this function will set an output pin to a specific
- *  value, either HIGH (1) or LOW (0).  If the pin is currently set to an INPUT instead of
- *  an OUTPUT, then this function acts like the old way of enabling / disabling the pullup
- *  resistor, which pre-1.0.0 versions of the Arduino API used - i.e., set HIGH to enable the
- *  pullup, or LOW to disable it.
- *
- *  Example:
- *
- *      myExpander.digitalWrite(3, HIGH);
- */
-void MCP23S17::digitalWrite(uint8_t pin, uint8_t value) {
+void MCP23S17Base::digitalWrite(uint8_t *slot, uint8_t pin, uint8_t value) {
     if (pin >= 16) {
         return;
     }
@@ -262,37 +284,30 @@ void MCP23S17::digitalWrite(uint8_t pin, uint8_t value) {
         latReg = MCP_OLATB;
     }
 
-    uint8_t mode = (_reg[dirReg] & (1<<pin)) == 0 ? OUTPUT : INPUT;
+    uint8_t mode = (slot[dirReg] & (1<<pin)) == 0 ? OUTPUT : INPUT;
     
     switch (mode) {
         case OUTPUT:
             if (value == 0) {
-                _reg[latReg] &= ~(1<<pin);
+                slot[index(latReg)] &= ~(1<<pin);
             } else {
-                _reg[latReg] |= (1<<pin);
+                slot[index(latReg)] |= (1<<pin);
             }
-            writeRegister(latReg);
+            writeRegister(slot, latReg);
             break;
 
         case INPUT:
             if (value == 0) {
-                _reg[puReg] &= ~(1<<pin);
+                slot[puReg] &= ~(1<<pin);
             } else {
-                _reg[puReg] |= (1<<pin);
+                slot[puReg] |= (1<<pin);
             }
-            writeRegister(puReg);
+            writeRegister(slot, puReg);
             break;
     }
 }
-    
-/*! This will return the current state of a pin set to INPUT, or the last
- *  value written to a pin set to OUTPUT.
- *
- *  Example:
- *
- *      byte value = myExpander.digitalRead(4);
- */
-uint8_t MCP23S17::digitalRead(uint8_t pin) {
+
+uint8_t MCP23S17Base::digitalRead(uint8_t *slot, uint8_t pin) {
     if (pin >= 16) {
         return 0;
     }
@@ -306,100 +321,47 @@ uint8_t MCP23S17::digitalRead(uint8_t pin) {
         latReg = MCP_OLATB;
     }
 
-    uint8_t mode = (_reg[dirReg] & (1<<pin)) == 0 ? OUTPUT : INPUT;
+    uint8_t mode = (slot[dirReg] & (1<<pin)) == 0 ? OUTPUT : INPUT;
 
     switch (mode) {
         case OUTPUT: 
-            return _reg[latReg] & (1<<pin) ? HIGH : LOW;
+            return slot[index(latReg)] & (1<<pin) ? HIGH : LOW;
         case INPUT:
-            readRegister(portReg);
-            return _reg[portReg] & (1<<pin) ? HIGH : LOW;
+            return readRegister(slot, portReg) & (1<<pin) ? HIGH : LOW;
     }
     return 0;
 }
 
-/*! This function returns the entire 8-bit value of a GPIO port.  Note that
- *  only the bits which correspond to a GPIO pin set to INPUT are valid.
- *  Other pins should be ignored.  The only parameter defines which port (A/B)
- *  to retrieve: 0 is port A and 1 (or anything other than 0) is port B.
- *
- *  Example:
- *
- *      byte portA = myExpander.readPort(0);
- */
-uint8_t MCP23S17::readPort(uint8_t port) {
+uint8_t MCP23S17Base::readPort(uint8_t *slot, uint8_t port) {
     if (port == 0) {
-        readRegister(MCP_GPIOA);
-        return _reg[MCP_GPIOA];
+        return readRegister(slot, MCP_GPIOA);
     } else {
-        readRegister(MCP_GPIOB);
-        return _reg[MCP_GPIOB];
+        return readRegister(slot, MCP_GPIOB);
     }
 }
 
-/*! This is a full 16-bit version of the parameterised readPort function.  This
- *  version reads the value of both ports and combines them into a single 16-bit
- *  value.
- *
- *  Example:
- *
- *      unsigned int value = myExpander.readPort();
- */
-uint16_t MCP23S17::readPort() {
-    readRegister(MCP_GPIOA);
-    readRegister(MCP_GPIOB);
-    return (_reg[MCP_GPIOB] << 8) | _reg[MCP_GPIOA];
+uint16_t MCP23S17Base::readPort(uint8_t *slot) {
+    return readPair(slot, MCP_GPIOA);
 }
 
-/*! This writes an 8-bit value to one of the two IO port banks (A/B) on the chip.
- *  The value is output direct to any pins on that bank that are set as OUTPUT. Any
- *  bits that correspond to pins set to INPUT are ignored.  As with the readPort
- *  function the first parameter defines which bank to use (0 = A, 1+ = B).
- *
- *  Example:
- *
- *      myExpander.writePort(0, 0x55);
- */
-void MCP23S17::writePort(uint8_t port, uint8_t val) {
+void MCP23S17Base::writePort(uint8_t *slot, uint8_t port, uint8_t val) {
     if (port == 0) {
-        _reg[MCP_OLATA] = val;
-        writeRegister(MCP_OLATA);
+        slot[index(MCP_OLATA)] = val;
+        writeRegister(slot, MCP_OLATA);
     } else {
-        _reg[MCP_OLATB] = val;
-        writeRegister(MCP_OLATB);
+        slot[index(MCP_OLATB)] = val;
+        writeRegister(slot, MCP_OLATB);
     }
 }
 
-/*! This is the 16-bit version of the writePort function.  This takes a single
- *  16-bit value and splits it between the two IO ports, the upper half going to
- *  port B and the lower to port A.
- *
- *  Example:
- *
- *      myExpander.writePort(0x55AA);
- */
-void MCP23S17::writePort(uint16_t val) {
-    _reg[MCP_OLATB] = val >> 8;
-    _reg[MCP_OLATA] = val & 0xFF;
-    writeRegister(MCP_OLATA);
-    writeRegister(MCP_OLATB);
+void MCP23S17Base::writePort(uint8_t *slot, uint16_t val) {
+    slot[index(MCP_OLATB)] = val >> 8;
+    slot[index(MCP_OLATA)] = val & 0xFF;
+    writeRegister(slot, MCP_OLATA);
+    writeRegister(slot, MCP_OLATB);
 }
 
-/*! This enables the interrupt functionality of a pin.  The interrupt type can be one of:
- *
- *  * CHANGE
- *  * RISING
- *  * FALLING
- *
- *  When an interrupt occurs the corresponding port's INT pin will be driven to it's configured
- *  level, and will remain there until either the port is read with a readPort or digitalRead, or the
- *  captured port status at the time of the interrupt is read using getInterruptValue.
- *
- *  Example:
- * 
- *      myExpander.enableInterrupt(4, RISING);
- */
-void MCP23S17::enableInterrupt(uint8_t pin, uint8_t type) {
+void MCP23S17Base::enableInterrupt(uint8_t *slot, uint8_t pin, uint8_t type) {
     if (pin >= 16) {
         return;
     }
@@ -416,33 +378,27 @@ void MCP23S17::enableInterrupt(uint8_t pin, uint8_t type) {
 
     switch (type) {
         case CHANGE:
-            _reg[intcon] &= ~(1<<pin);
+            slot[intcon] &= ~(1<<pin);
             break;
         case RISING:
-            _reg[intcon] |= (1<<pin);
-            _reg[defval] &= ~(1<<pin);
+            slot[intcon] |= (1<<pin);
+            slot[defval] &= ~(1<<pin);
             break;
         case FALLING:
-            _reg[intcon] |= (1<<pin);
-            _reg[defval] |= (1<<pin);
+            slot[intcon] |= (1<<pin);
+            slot[defval] |= (1<<pin);
             break;
 
     }
 
-    _reg[gpinten] |= (1<<pin);
+    slot[gpinten] |= (1<<pin);
 
-    writeRegister(intcon);
-    writeRegister(defval);
-    writeRegister(gpinten);
+    writeRegister(slot, intcon);
+    writeRegister(slot, defval);
+    writeRegister(slot, gpinten);
 }
 
-/*! This disables the interrupt functionality of a pin.
- *
- *  Example:
- *
- *      myExpander.disableInterrupt(4);
- */
-void MCP23S17::disableInterrupt(uint8_t pin) {
+void MCP23S17Base::disableInterrupt(uint8_t *slot, uint8_t pin) {
     if (pin >= 16) {
         return;
     }
@@ -453,144 +409,317 @@ void MCP23S17::disableInterrupt(uint8_t pin) {
         gpinten = MCP_GPINTENB;
     }
 
-    _reg[gpinten] &= ~(1<<pin);
-    writeRegister(gpinten);
+    slot[gpinten] &= ~(1<<pin);
+    writeRegister(slot, gpinten);
+}
+
+uint16_t MCP23S17Base::getInterruptMask(uint8_t *slot) {
+    return (slot[MCP_GPINTENB] << 8) | slot[MCP_GPINTENA];
+}
+
+void MCP23S17Base::setInterruptMask(uint8_t *slot, uint16_t mask) {
+    slot[MCP_GPINTENA] = mask & 0xFF;
+    slot[MCP_GPINTENB] = mask >> 8;
+    writeRegister(slot, MCP_GPINTENA);
+    writeRegister(slot, MCP_GPINTENB);
+}
+
+void MCP23S17Base::setIOCON(uint8_t *slot, uint8_t bit, boolean set) {
+    if (set) {
+        slot[MCP_IOCONA] |= (1<<bit);
+    } else {
+        slot[MCP_IOCONA] &= ~(1<<bit);
+    }
+    writeRegister(slot, MCP_IOCONA);
 }
 
-/*! The two IO banks can have their INT pins connected together.
- *  This enables you to monitor both banks with just one interrupt pin
- *  on the host microcontroller.  Calling setMirror with a parameter of 
- *  *true* will enable this feature.  Calling it with *false* will disable
- *  it.
+/*! This returns the total number of mismatches between the chip and the local
+ *  mirror that verifyStep has found (and repaired) since the counter was last
+ *  cleared.  A detected chip reset counts as a single mismatch.  For an MCP23S17Bus
+ *  this is the total for all the chips on the bus.
  *
  *  Example:
  *
- *      myExpander.setMirror(true);
+ *      unsigned int errors = myExpander.getMismatchCount();
  */
-void MCP23S17::setMirror(boolean m) {
-    if (m) {
-        _reg[MCP_IOCONA] |= (1<<6);
-        _reg[MCP_IOCONB] |= (1<<6);
-    } else {
-        _reg[MCP_IOCONA] &= ~(1<<6);
-        _reg[MCP_IOCONB] &= ~(1<<6);
-    }
-    writeRegister(MCP_IOCONA);
+uint16_t MCP23S17Base::getMismatchCount() {
+    return _mismatches;
 }
 
-/*! This function returns a 16-bit bitmap of the the pin or pins that have cause an interrupt to fire.
+/*! This resets the mismatch counter returned by getMismatchCount to zero.
  *
  *  Example:
  *
- *      unsigned int pins = myExpander.getInterruptPins();
+ *      myExpander.clearMismatchCount();
  */
-uint16_t MCP23S17::getInterruptPins() {
-    readRegister(MCP_INTFA);
-    readRegister(MCP_INTFB);
-
-    return (_reg[MCP_INTFB] << 8) | _reg[MCP_INTFA];
+void MCP23S17Base::clearMismatchCount() {
+    _mismatches = 0;
 }
 
-/*! This returns a snapshot of the IO pin states at the moment the last interrupt occured.  Reading
- *  this value clears the interrupt status (and hence the INT pins) for the whole chip.
- *  Until this value is read (or the current live port value is read) no further interrupts can
- *  be indicated.
- *
+/*! The constructor takes three parameters.  The first is an SPI class
+ *  pointer.  This is the address of an SPI object (either the default
+ *  SPI object on the Arduino, or an object made using the DSPIx classes
+ *  on the chipKIT).  The second parameter is the chip select pin number
+ *  to use when communicating with the chip.  The third is the internal
+ *  address number of the chip.  This is controlled by the three Ax pins
+ *  on the chip.
+ *  
  *  Example:
  *
- *      unsigned int pinValues = myExpander.getInterruptValue();
+ *      MCP23S17 myExpander(&SPI, 10, 0);
+ * 
  */
-uint16_t MCP23S17::getInterruptValue() {
-    readRegister(MCP_INTCAPA);
-    readRegister(MCP_INTCAPB);
+#ifdef __PIC32MX__
+MCP23S17::MCP23S17(DSPI *spi, uint8_t cs, uint8_t addr) : MCP23S17Base(spi, cs) {
+#else
+MCP23S17::MCP23S17(SPIClass *spi, uint8_t cs, uint8_t addr) : MCP23S17Base(spi, cs) {
+#endif
+    initSlot(_reg, addr);
+    _verifyReg = MCP_IOCONA;
+    _resetCallback = NULL;
+}
 
-    return (_reg[MCP_INTCAPB] << 8) | _reg[MCP_INTCAPA];
-} 
+#ifdef __PIC32MX__
+MCP23S17::MCP23S17(DSPI &spi, uint8_t cs, uint8_t addr) : MCP23S17(&spi, cs, addr) {
+#else
+MCP23S17::MCP23S17(SPIClass &spi, uint8_t cs, uint8_t addr) : MCP23S17(&spi, cs, addr) {
+#endif
+}
 
-/*! This sets the "active" level for an interrupt.  HIGH means the interrupt pin
- *  will go HIGH when an interrupt occurs, LOW means it will go LOW.
+/*! This performs one small step of a background check that the chip's configuration
+ *  still matches the local mirror held by the library.  Each call reads back one A/B
+ *  register pair out of the configuration registers (IODIR, IPOL, GPINTEN, DEFVAL,
+ *  INTCON, IOCON, GPPU) and the output latches (OLAT), cycling through them on
+ *  successive calls.  Any register that differs from the mirror is rewritten and
+ *  counted as a mismatch.  The interrupt flag, capture and GPIO registers are never
+ *  read, so calling this has no effect on pending interrupts.
+ *
+ *  If IOCON reads back with address-based communication (HAEN) turned off, or as 0xFF
+ *  (a reset chip only answers on address 0, so at other addresses nothing drives MISO),
+ *  the chip is assumed to have been reset.
+ *
+ *  A reset chip can only be reached by writing IOCON at address 0, which would also
+ *  overwrite the IOCON of any working chip at address 0 on the same chip select line.
+ *  So only a chip at address 0 is reinitialised from the mirror here.  A chip at any
+ *  other address is just reported: it is marked offline, so only its IOCON is checked
+ *  from then on, and the function set with setResetCallback (if any) is called, which
+ *  can restore it with begin().  Chips sharing a chip select line are best grouped on
+ *  an MCP23S17Bus, which knows every chip's IOCON and restores them all itself.
+ *
+ *  A chip at address 0 that still does not answer after being reinitialised is taken
+ *  to be missing.  It is marked offline without calling the callback.
+ *
+ *  An offline chip comes back once its IOCON reads back as mirrored, or when begin()
+ *  is called.
+ *
+ *  The return value is the number of registers that had to be repaired, or 22 if the
+ *  chip was found to have been reset.
  *
  *  Example:
  *
- *      myExpander.setInterruptLevel(HIGH);
+ *      void loop() {
+ *          myExpander.verifyStep();
+ *      }
  */
-void MCP23S17::setInterruptLevel(uint8_t level) {
-    if (level == LOW) {
-        _reg[MCP_IOCONA] &= ~(1<<1);
-        _reg[MCP_IOCONB] &= ~(1<<1);
-    } else {
-        _reg[MCP_IOCONA] |= (1<<1);
-        _reg[MCP_IOCONB] |= (1<<1);
+uint8_t MCP23S17::verifyStep() {
+    uint8_t base = _verifyReg;
+    _verifyReg = nextRange(base);
+
+    uint8_t bad = verifyRange(_reg, base);
+    if (bad == VERIFY_RESET) {
+        if ((_reg[SLOT_ADDR] & 0b111) == 0) {
+            enableAddressing(_reg[MCP_IOCONA]);
+            writeAll(_reg);
+            if (!responding(_reg)) {
+                return 0;
+            }
+        } else {
+            _reg[SLOT_ADDR] |= SLOT_OFFLINE;
+        }
+        if (_resetCallback != NULL) {
+            _resetCallback(this);
+        }
+        return 22;
     }
-    writeRegister(MCP_IOCONA);
+    return bad;
 }
 
-/*! Using this function it is possible to configure the interrupt output pins to be open
- *  drain.  This means that interrupt pins from multiple chips can share the same interrupt
- *  pin on the host MCU.  This causes the level set by setInterruptLevel to be ignored.  A
- *  pullup resistor will be required on the host MCU's interrupt pin.
+/*! This sets a function to be called whenever verifyStep detects that the chip has
+ *  been reset (for instance by a brown-out).  The function is passed a pointer to the
+ *  MCP23S17 object concerned, so one function can serve several chips.  A chip at
+ *  address 0 has already been restored when it is called; any other chip can be
+ *  restored by calling its begin().  Pass NULL to remove the callback.
  *
  *  Example:
  *
- *      myExpander.setInterruptOD(true);
+ *      void expanderReset(MCP23S17 *chip) {
+ *          Serial.println("Expander was reset");
+ *          chip->begin();
+ *      }
+ *
+ *      myExpander.setResetCallback(expanderReset);
  */
-void MCP23S17::setInterruptOD(boolean openDrain) {
-    if (openDrain) {
-        _reg[MCP_IOCONA] |= (1<<2);
-        _reg[MCP_IOCONB] |= (1<<2);
-    } else {
-        _reg[MCP_IOCONA] &= ~(1<<2);
-        _reg[MCP_IOCONB] &= ~(1<<2);
+void MCP23S17::setResetCallback(void (*cb)(MCP23S17 *chip)) {
+    _resetCallback = cb;
+}
+
+/*! The bus constructor takes four parameters.  The first is an SPI class
+ *  pointer, as for the MCP23S17 constructor.  The second is the chip select pin
+ *  number shared by all the chips on the bus.  The third is an array of
+ *  MCP23S17_SLOT_SIZE byte slots to hold the chips' register mirrors, and the
+ *  fourth is the number of slots in it - one for each chip on the bus, up to the
+ *  eight addresses a chip select line can have.
+ *
+ *  Example:
+ *
+ *      uint8_t myPool[4][MCP23S17_SLOT_SIZE];
+ *      MCP23S17Bus myBus(&SPI, 10, myPool, 4);
+ */
+#ifdef __PIC32MX__
+MCP23S17Bus::MCP23S17Bus(DSPI *spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size) : MCP23S17Base(spi, cs) {
+#else
+MCP23S17Bus::MCP23S17Bus(SPIClass *spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size) : MCP23S17Base(spi, cs) {
+#endif
+    _pool = pool;
+    _size = (size > 8) ? 8 : size;
+    _used = 0;
+    _verifySlot = 0;
+    _verifyReg = MCP_IOCONA;
+    _resetCallback = NULL;
+}
+
+#ifdef __PIC32MX__
+MCP23S17Bus::MCP23S17Bus(DSPI &spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size) : MCP23S17Bus(&spi, cs, pool, size) {
+#else
+MCP23S17Bus::MCP23S17Bus(SPIClass &spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size) : MCP23S17Bus(&spi, cs, pool, size) {
+#endif
+}
+
+/*! This private function hands out the next free slot in the pool to a chip with
+ *  the given address, returning its number, or 0xFF if the pool is full.
+ */
+uint8_t MCP23S17Bus::attach(uint8_t addr) {
+    if (_used >= _size) {
+        return 0xFF;
+    }
+    initSlot(_pool[_used], addr);
+    return _used++;
+}
+
+/*! This private function returns the IOCON value to broadcast to address 0 when
+ *  turning on address-based communication: that of the chip at address 0 if it is
+ *  on the bus, so its settings are kept, or otherwise that of the given slot.
+ */
+uint8_t MCP23S17Bus::sharedIOCON(uint8_t *fallback) {
+    for (uint8_t i = 0; i < _used; i++) {
+        if ((_pool[i][SLOT_ADDR] & 0b111) == 0) {
+            return _pool[i][MCP_IOCONA];
+        }
     }
-    writeRegister(MCP_IOCONA);
+    return fallback[MCP_IOCONA];
 }
 
-/*! This function returns an 8-bit bitmap of the Port-A pin or pins that have caused an interrupt to fire.
+/*! This works like MCP23S17::verifyStep, but for the whole bus: each call checks
+ *  one register pair of one chip, moving on to the next chip once all of a chip's
+ *  registers have been checked.
+ *
+ *  Since a power glitch on the bus resets all its chips at once, and turning a reset
+ *  chip's address-based communication back on also reaches every other reset chip,
+ *  finding one chip reset reinitialises every chip on the bus from its mirror.  The
+ *  callback is then called if the chip found reset is answering again.
  *
  *  Example:
  *
- *      unsigned int pins = myExpander.getInterruptAPins();
+ *      void loop() {
+ *          myBus.verifyStep();
+ *      }
  */
-uint8_t MCP23S17::getInterruptAPins() {
-    readRegister(MCP_INTFA);
-    return  _reg[MCP_INTFA];
+uint8_t MCP23S17Bus::verifyStep() {
+    uint8_t *s = slot(_verifySlot);
+    if (s == NULL) {
+        return 0;
+    }
+    uint8_t base = _verifyReg;
+    _verifyReg = nextRange(base);
+    if (_verifyReg == MCP_IOCONA) {
+        _verifySlot++;
+        if (_verifySlot >= _used) {
+            _verifySlot = 0;
+        }
+    }
+
+    uint8_t bad = verifyRange(s, base);
+    if (bad == VERIFY_RESET) {
+        enableAddressing(sharedIOCON(s));
+        for (uint8_t i = 0; i < _used; i++) {
+            writeAll(_pool[i]);
+            responding(_pool[i]);
+        }
+        if ((s[SLOT_ADDR] & SLOT_OFFLINE) != 0) {
+            return 0;
+        }
+        if (_resetCallback != NULL) {
+            _resetCallback(this);
+        }
+        return 22;
+    }
+    return bad;
 }
 
-/*! This returns a snapshot of the Port-A IO pin states at the moment the last interrupt occured.  Reading
- *  this value clears the interrupt status (and hence the INT pins) for the port.
- *  Until this value is read (or the current live port value is read) no further interrupts can
- *  be indicated.
+/*! This sets a function to be called whenever verifyStep detects that a chip on
+ *  the bus has been reset and has reinitialised it.  The function is passed a
+ *  pointer to the bus.  Pass NULL to remove the callback.
  *
  *  Example:
  *
- *      unsigned int pinValues = myExpander.getInterruptAValue();
+ *      void busReset(MCP23S17Bus *bus) {
+ *          Serial.println("Expander was reset");
+ *      }
+ *
+ *      myBus.setResetCallback(busReset);
  */
-uint8_t MCP23S17::getInterruptAValue() {
-    readRegister(MCP_INTCAPA);
-    return _reg[MCP_INTCAPA];
-} 
+void MCP23S17Bus::setResetCallback(void (*cb)(MCP23S17Bus *bus)) {
+    _resetCallback = cb;
+}
 
-/*! This function returns an 8-bit bitmap of the Port-B pin or pins that have caused an interrupt to fire.
+/*! The chip constructor takes two parameters.  The first is the MCP23S17Bus the
+ *  chip is on, and the second is the internal address number of the chip.  This is
+ *  controlled by the three Ax pins on the chip.  The chip only takes its slot in the
+ *  bus's pool when begin() is called, so the bus and its chips can be created in any
+ *  order.
  *
  *  Example:
  *
- *      unsigned int pins = myExpander.getInterruptBPins();
+ *      MCP23S17Chip myExpander(&myBus, 0);
  */
-uint8_t MCP23S17::getInterruptBPins() {
-    readRegister(MCP_INTFB);
-    return _reg[MCP_INTFB];
+MCP23S17Chip::MCP23S17Chip(MCP23S17Bus *bus, uint8_t addr) {
+    _bus = bus;
+    _slot = UNATTACHED | (addr & 0b111);
+}
+
+MCP23S17Chip::MCP23S17Chip(MCP23S17Bus &bus, uint8_t addr) : MCP23S17Chip(&bus, addr) {
 }
 
-/*! This returns a snapshot of the Port-B IO pin states at the moment the last interrupt occured.  Reading
- *  this value clears the interrupt status (and hence the INT pins) for the port.
- *  Until this value is read (or the current live port value is read) no further interrupts can
- *  be indicated.
+/*! The begin function takes a slot for the chip in the bus's pool, the first time
+ *  it is called, and then configures the chip as MCP23S17::begin does.  It returns
+ *  false, leaving all the chip's other functions doing nothing, if the pool is
+ *  already full.
  *
  *  Example:
  *
- *      unsigned int pinValues = myExpander.getInterruptBValue();
+ *      if (!myExpander.begin()) {
+ *          Serial.println("Pool too small");
+ *      }
  */
-uint8_t MCP23S17::getInterruptBValue() {
-    readRegister(MCP_INTCAPB);
-    return _reg[MCP_INTCAPB];
-} 
+boolean MCP23S17Chip::begin() {
+    if (_slot & UNATTACHED) {
+        uint8_t n = _bus->attach(_slot & 0b111);
+        if (n == 0xFF) {
+            return false;
+        }
+        _slot = n;
+    }
+    uint8_t *s = slot();
+    _bus->beginChip(s, _bus->sharedIOCON(s));
+    return true;
+}
@@ -44,17 +44,27 @@
 #include <SPI.h>
 #endif
 
-class MCP23S17 {
-    private:
+/*! Number of bytes of storage each chip needs for its local register mirror: the
+ *  configuration registers (IODIR to GPPU) at their own addresses, then the two
+ *  output latches (OLAT).  IOCONA and IOCONB are the same register, so IOCONB's
+ *  place holds the chip address instead.  The interrupt flag, capture and GPIO
+ *  registers are only ever read, so they are not mirrored.
+ */
+#define MCP23S17_SLOT_SIZE 16
+
+/*! This is the common part of MCP23S17 and MCP23S17Bus.  It holds the SPI settings
+ *  shared by every chip on a chip select line and does the actual work on a chip,
+ *  given that chip's mirror storage.
+ */
+class MCP23S17Base {
+    protected:
 #ifdef __PIC32MX__
         DSPI *_spi; /*! This points to a valid SPI object created from the chipKIT DSPI library. */
 #else
         SPIClass *_spi; /*! This points to a valid SPI object created from the Arduino SPI library. */
 #endif
         uint8_t _cs;    /*! Chip select pin */
-        uint8_t _addr;  /*! 3-bit chip address */
-    
-        uint8_t _reg[22];   /*! Local mirrors of the 22 internal registers of the MCP23S17 chip */
+        uint16_t _mismatches;   /*! Number of mirror mismatches found by verifyStep() */
 
         enum {
             MCP_IODIRA,     MCP_IODIRB,
@@ -70,11 +80,72 @@ class MCP23S17 {
             MCP_OLATA,      MCP_OLATB
         };
 
-        void readRegister(uint8_t addr); 
-        void writeRegister(uint8_t addr);
-        void readAll();
-        void writeAll();
-    
+        enum {
+            SLOT_ADDR = MCP_IOCONB,             /*! Position of the chip address in a slot */
+            SLOT_OFFLINE = 0x80,                /*! Address byte flag for a chip that is missing or awaiting begin() */
+            VERIFY_RESET = 0xFF                 /*! verifyRange() result for a reset chip */
+        };
+
+        /*! Maps a mirrored register address to its position in a slot. */
+        static inline uint8_t index(uint8_t addr) {
+            return (addr < MCP_OLATA) ? addr : addr - (MCP_OLATA - MCP_GPPUB - 1);
+        }
+
+        /*! Opcode for talking to the chip whose mirror is in the given slot. */
+        static inline uint8_t opcode(uint8_t *slot, uint8_t read) {
+            return 0b01000000 | ((slot[SLOT_ADDR] & 0b111) << 1) | read;
+        }
+
+#ifdef __PIC32MX__
+        MCP23S17Base(DSPI *spi, uint8_t cs);
+#else
+        MCP23S17Base(SPIClass *spi, uint8_t cs);
+#endif
+
+        void initSlot(uint8_t *slot, uint8_t addr);
+        void select(uint8_t cmd, uint8_t addr);
+        void beginChip(uint8_t *slot, uint8_t iocon);
+        uint16_t readRegisters(uint8_t *slot, uint8_t addr, uint8_t count);
+        inline uint8_t readRegister(uint8_t *slot, uint8_t addr) {
+            return readRegisters(slot, addr, 1);
+        }
+        inline uint16_t readPair(uint8_t *slot, uint8_t addr) {
+            return readRegisters(slot, addr, 2);
+        }
+        void writeRegister(uint8_t *slot, uint8_t addr);
+        void writeAll(uint8_t *slot);
+        void enableAddressing(uint8_t iocon);
+        boolean responding(uint8_t *slot);
+        uint8_t verifyRange(uint8_t *slot, uint8_t base);
+        static uint8_t nextRange(uint8_t base);
+
+        void pinMode(uint8_t *slot, uint8_t pin, uint8_t mode);
+        void digitalWrite(uint8_t *slot, uint8_t pin, uint8_t value);
+        uint8_t digitalRead(uint8_t *slot, uint8_t pin);
+        uint8_t readPort(uint8_t *slot, uint8_t port);
+        uint16_t readPort(uint8_t *slot);
+        void writePort(uint8_t *slot, uint8_t port, uint8_t val);
+        void writePort(uint8_t *slot, uint16_t val);
+        void enableInterrupt(uint8_t *slot, uint8_t pin, uint8_t type);
+        void disableInterrupt(uint8_t *slot, uint8_t pin);
+        void setInterruptMask(uint8_t *slot, uint16_t mask);
+        uint16_t getInterruptMask(uint8_t *slot);
+        void setIOCON(uint8_t *slot, uint8_t bit, boolean set);
+
+    public:
+        uint16_t getMismatchCount();
+        void clearMismatchCount();
+};
+
+/*! The MCP23S17 class controls a single chip, keeping that chip's register mirror
+ *  in the object itself.
+ */
+class MCP23S17 : public MCP23S17Base {
+    private:
+        uint8_t _reg[MCP23S17_SLOT_SIZE];   /*! Local mirror of the chip's registers */
+        uint8_t _verifyReg;     /*! First register of the range the next verifyStep() will check */
+        void (*_resetCallback)(MCP23S17 *chip); /*! Called when verifyStep() detects a chip reset */
+
     public:
 #ifdef __PIC32MX__
         MCP23S17(DSPI *spi, uint8_t cs, uint8_t addr);
@@ -83,25 +154,417 @@ class MCP23S17 {
         MCP23S17(SPIClass *spi, uint8_t cs, uint8_t addr);
         MCP23S17(SPIClass &spi, uint8_t cs, uint8_t addr);
 #endif
-        void begin();
-        void pinMode(uint8_t pin, uint8_t mode);
-        void digitalWrite(uint8_t pin, uint8_t value);
-        uint8_t digitalRead(uint8_t pin);
-
-        uint8_t readPort(uint8_t port);
-        uint16_t readPort();
-        void writePort(uint8_t port, uint8_t val);
-        void writePort(uint16_t val);
-        void enableInterrupt(uint8_t pin, uint8_t type);
-        void disableInterrupt(uint8_t pin);
-        void setMirror(boolean m);
-        uint16_t getInterruptPins();
-        uint16_t getInterruptValue();
-        void setInterruptLevel(uint8_t level);
-        void setInterruptOD(boolean openDrain);
-        uint8_t getInterruptAPins();
-        uint8_t getInterruptAValue();
-        uint8_t getInterruptBPins();
-        uint8_t getInterruptBValue();
+        /*! The begin function performs the initial configuration of the IO expander chip.
+         *  Not only does it set up the SPI communications, but it also configures the chip
+         *  for address-based communication and sets the default parameters and registers
+         *  to sensible values.
+         *
+         *  Example:
+         *
+         *      myExpander.begin();
+         *
+         */
+        inline void begin() {
+            beginChip(_reg, _reg[MCP_IOCONA]);
+        }
+
+        /*! Just like the pinMode() function of the Arduino API, this function sets the
+         *  direction of the pin.  The first parameter is the pin nimber (0-15) to use,
+         *  and the second parameter is the direction of the pin.  There are standard
+         *  Arduino macros for different modes which should be used.  The supported macros are:
+         *
+         *  * OUTPUT
+         *  * INPUT
+         *  * INPUT_PULLUP
+         *
+         *  The INPUT_PULLUP mode enables the weak pullup that is available on any pin.
+         *
+         *  Example:
+         *
+         *      myExpander.pinMode(5, INPUT_PULLUP);
+         */
+        inline void pinMode(uint8_t pin, uint8_t mode) {
+            MCP23S17Base::pinMode(_reg, pin, mode);
+        }
+
+        /*! Like the Arduino API's namesake, this function will set an output pin to a specific
+         *  value, either HIGH (1) or LOW (0).  If the pin is currently set to an INPUT instead of
+         *  an OUTPUT, then this function acts like the old way of enabling / disabling the pullup
+         *  resistor, which pre-1.0.0 versions of the Arduino API used - i.e., set HIGH to enable the
+         *  pullup, or LOW to disable it.
+         *
+         *  Example:
+         *
+         *      myExpander.digitalWrite(3, HIGH);
+         */
+        inline void digitalWrite(uint8_t pin, uint8_t value) {
+            MCP23S17Base::digitalWrite(_reg, pin, value);
+        }
+
+        /*! This will return the current state of a pin set to INPUT, or the last
+         *  value written to a pin set to OUTPUT.
+         *
+         *  Example:
+         *
+         *      byte value = myExpander.digitalRead(4);
+         */
+        inline uint8_t digitalRead(uint8_t pin) {
+            return MCP23S17Base::digitalRead(_reg, pin);
+        }
+
+        /*! This function returns the entire 8-bit value of a GPIO port.  Note that
+         *  only the bits which correspond to a GPIO pin set to INPUT are valid.
+         *  Other pins should be ignored.  The only parameter defines which port (A/B)
+         *  to retrieve: 0 is port A and 1 (or anything other than 0) is port B.
+         *
+         *  Example:
+         *
+         *      byte portA = myExpander.readPort(0);
+         */
+        inline uint8_t readPort(uint8_t port) {
+            return MCP23S17Base::readPort(_reg, port);
+        }
+
+        /*! This is a full 16-bit version of the parameterised readPort function.  This
+         *  version reads the value of both ports in a single transfer and combines them
+         *  into a single 16-bit value.
+         *
+         *  Example:
+         *
+         *      unsigned int value = myExpander.readPort();
+         */
+        inline uint16_t readPort() {
+            return MCP23S17Base::readPort(_reg);
+        }
+
+        /*! This writes an 8-bit value to one of the two IO port banks (A/B) on the chip.
+         *  The value is output direct to any pins on that bank that are set as OUTPUT. Any
+         *  bits that correspond to pins set to INPUT are ignored.  As with the readPort
+         *  function the first parameter defines which bank to use (0 = A, 1+ = B).
+         *
+         *  Example:
+         *
+         *      myExpander.writePort(0, 0x55);
+         */
+        inline void writePort(uint8_t port, uint8_t val) {
+            MCP23S17Base::writePort(_reg, port, val);
+        }
+
+        /*! This is the 16-bit version of the writePort function.  This takes a single
+         *  16-bit value and splits it between the two IO ports, the upper half going to
+         *  port B and the lower to port A.
+         *
+         *  Example:
+         *
+         *      myExpander.writePort(0x55AA);
+         */
+        inline void writePort(uint16_t val) {
+            MCP23S17Base::writePort(_reg, val);
+        }
+
+        /*! This enables the interrupt functionality of a pin.  The interrupt type can be one of:
+         *
+         *  * CHANGE
+         *  * RISING
+         *  * FALLING
+         *
+         *  When an interrupt occurs the corresponding port's INT pin will be driven to it's configured
+         *  level, and will remain there until either the port is read with a readPort or digitalRead, or the
+         *  captured port status at the time of the interrupt is read using getInterruptValue.
+         *
+         *  Example:
+         * 
+         *      myExpander.enableInterrupt(4, RISING);
+         */
+        inline void enableInterrupt(uint8_t pin, uint8_t type) {
+            MCP23S17Base::enableInterrupt(_reg, pin, type);
+        }
+
+        /*! This disables the interrupt functionality of a pin.
+         *
+         *  Example:
+         *
+         *      myExpander.disableInterrupt(4);
+         */
+        inline void disableInterrupt(uint8_t pin) {
+            MCP23S17Base::disableInterrupt(_reg, pin);
+        }
+
+        /*! This returns a 16-bit bitmap of the pins that currently have their interrupt
+         *  functionality enabled, with port A in the lower half and port B in the upper.
+         *
+         *  Example:
+         *
+         *      unsigned int enabled = myExpander.getInterruptMask();
+         */
+        inline uint16_t getInterruptMask() {
+            return MCP23S17Base::getInterruptMask(_reg);
+        }
+
+        /*! This enables or disables the interrupt functionality of all 16 pins at once from
+         *  a bitmap: a 1 enables the interrupt for that pin, a 0 disables it.  The interrupt
+         *  type of each pin (as set by enableInterrupt) is left untouched, so a mask saved with
+         *  getInterruptMask can be used to temporarily turn interrupts off and back on again.
+         *
+         *  Example:
+         *
+         *      unsigned int enabled = myExpander.getInterruptMask();
+         *      myExpander.setInterruptMask(0);
+         *      // ...
+         *      myExpander.setInterruptMask(enabled);
+         */
+        inline void setInterruptMask(uint16_t mask) {
+            MCP23S17Base::setInterruptMask(_reg, mask);
+        }
+
+        /*! The two IO banks can have their INT pins connected together.
+         *  This enables you to monitor both banks with just one interrupt pin
+         *  on the host microcontroller.  Calling setMirror with a parameter of 
+         *  *true* will enable this feature.  Calling it with *false* will disable
+         *  it.
+         *
+         *  Example:
+         *
+         *      myExpander.setMirror(true);
+         */
+        inline void setMirror(boolean m) {
+            setIOCON(_reg, 6, m);
+        }
+
+        /*! This function returns a 16-bit bitmap of the the pin or pins that have cause an interrupt to fire.
+         *
+         *  Example:
+         *
+         *      unsigned int pins = myExpander.getInterruptPins();
+         */
+        inline uint16_t getInterruptPins() {
+            return readPair(_reg, MCP_INTFA);
+        }
+
+        /*! This returns a snapshot of the IO pin states at the moment the last interrupt occured.  Reading
+         *  this value clears the interrupt status (and hence the INT pins) for the whole chip.
+         *  Until this value is read (or the current live port value is read) no further interrupts can
+         *  be indicated.
+         *
+         *  Example:
+         *
+         *      unsigned int pinValues = myExpander.getInterruptValue();
+         */
+        inline uint16_t getInterruptValue() {
+            return readPair(_reg, MCP_INTCAPA);
+        }
+
+        /*! This sets the "active" level for an interrupt.  HIGH means the interrupt pin
+         *  will go HIGH when an interrupt occurs, LOW means it will go LOW.
+         *
+         *  Example:
+         *
+         *      myExpander.setInterruptLevel(HIGH);
+         */
+        inline void setInterruptLevel(uint8_t level) {
+            setIOCON(_reg, 1, level != LOW);
+        }
+
+        /*! Using this function it is possible to configure the interrupt output pins to be open
+         *  drain.  This means that interrupt pins from multiple chips can share the same interrupt
+         *  pin on the host MCU.  This causes the level set by setInterruptLevel to be ignored.  A
+         *  pullup resistor will be required on the host MCU's interrupt pin.
+         *
+         *  Example:
+         *
+         *      myExpander.setInterruptOD(true);
+         */
+        inline void setInterruptOD(boolean openDrain) {
+            setIOCON(_reg, 2, openDrain);
+        }
+
+        /*! This function returns an 8-bit bitmap of the Port-A pin or pins that have caused an interrupt to fire.
+         *
+         *  Example:
+         *
+         *      unsigned int pins = myExpander.getInterruptAPins();
+         */
+        inline uint8_t getInterruptAPins() {
+            return readRegister(_reg, MCP_INTFA);
+        }
+
+        /*! This returns a snapshot of the Port-A IO pin states at the moment the last interrupt occured.  Reading
+         *  this value clears the interrupt status (and hence the INT pins) for the port.
+         *  Until this value is read (or the current live port value is read) no further interrupts can
+         *  be indicated.
+         *
+         *  Example:
+         *
+         *      unsigned int pinValues = myExpander.getInterruptAValue();
+         */
+        inline uint8_t getInterruptAValue() {
+            return readRegister(_reg, MCP_INTCAPA);
+        }
+
+        /*! This function returns an 8-bit bitmap of the Port-B pin or pins that have caused an interrupt to fire.
+         *
+         *  Example:
+         *
+         *      unsigned int pins = myExpander.getInterruptBPins();
+         */
+        inline uint8_t getInterruptBPins() {
+            return readRegister(_reg, MCP_INTFB);
+        }
+
+        /*! This returns a snapshot of the Port-B IO pin states at the moment the last interrupt occured.  Reading
+         *  this value clears the interrupt status (and hence the INT pins) for the port.
+         *  Until this value is read (or the current live port value is read) no further interrupts can
+         *  be indicated.
+         *
+         *  Example:
+         *
+         *      unsigned int pinValues = myExpander.getInterruptBValue();
+         */
+        inline uint8_t getInterruptBValue() {
+            return readRegister(_reg, MCP_INTCAPB);
+        }
+
+        uint8_t verifyStep();
+        void setResetCallback(void (*cb)(MCP23S17 *chip));
+};
+
+/*! An MCP23S17Bus groups the chips sharing one chip select line for use on small
+ *  microcontrollers.  The bus holds the SPI settings, the verifyStep() state and a
+ *  pool of register mirrors supplied by the caller, one MCP23S17_SLOT_SIZE byte slot
+ *  per chip, so each MCP23S17Chip object only needs to know its bus and slot.
+ */
+class MCP23S17Bus : public MCP23S17Base {
+    friend class MCP23S17Chip;
+
+    private:
+        uint8_t (*_pool)[MCP23S17_SLOT_SIZE];   /*! Register mirror slots, one per chip */
+        uint8_t _size;          /*! Number of slots in the pool */
+        uint8_t _used;          /*! Number of slots handed out to chips */
+        uint8_t _verifySlot;    /*! Slot the next verifyStep() will check */
+        uint8_t _verifyReg;     /*! First register of the range the next verifyStep() will check */
+        void (*_resetCallback)(MCP23S17Bus *bus); /*! Called when verifyStep() detects a chip reset */
+
+        uint8_t attach(uint8_t addr);
+        uint8_t sharedIOCON(uint8_t *fallback);
+        inline uint8_t *slot(uint8_t n) {
+            return (n < _used) ? _pool[n] : NULL;
+        }
+
+    public:
+#ifdef __PIC32MX__
+        MCP23S17Bus(DSPI *spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size);
+        MCP23S17Bus(DSPI &spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size);
+#else
+        MCP23S17Bus(SPIClass *spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size);
+        MCP23S17Bus(SPIClass &spi, uint8_t cs, uint8_t (*pool)[MCP23S17_SLOT_SIZE], uint8_t size);
+#endif
+        uint8_t verifyStep();
+        void setResetCallback(void (*cb)(MCP23S17Bus *bus));
+};
+
+/*! An MCP23S17Chip is a chip on an MCP23S17Bus.  It has the same pin and port
+ *  functions as MCP23S17, which are documented there, but keeps its register mirror
+ *  in the bus's pool.  Until begin() has found it a slot in the pool all its other
+ *  functions do nothing.
+ */
+class MCP23S17Chip {
+    private:
+        MCP23S17Bus *_bus;  /*! The bus this chip is on */
+        uint8_t _slot;      /*! This chip's slot in the bus's pool, or UNATTACHED and the chip address */
+
+        enum {
+            UNATTACHED = 0x80   /*! _slot flag for a chip that begin() has not yet given a slot */
+        };
+
+        inline uint8_t *slot() {
+            return _bus->slot(_slot);
+        }
+
+    public:
+        MCP23S17Chip(MCP23S17Bus *bus, uint8_t addr);
+        MCP23S17Chip(MCP23S17Bus &bus, uint8_t addr);
+
+        boolean begin();
+        inline void pinMode(uint8_t pin, uint8_t mode) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->pinMode(s, pin, mode);
+        }
+        inline void digitalWrite(uint8_t pin, uint8_t value) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->digitalWrite(s, pin, value);
+        }
+        inline uint8_t digitalRead(uint8_t pin) {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->digitalRead(s, pin) : 0;
+        }
+
+        inline uint8_t readPort(uint8_t port) {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readPort(s, port) : 0;
+        }
+        inline uint16_t readPort() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readPort(s) : 0;
+        }
+        inline void writePort(uint8_t port, uint8_t val) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->writePort(s, port, val);
+        }
+        inline void writePort(uint16_t val) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->writePort(s, val);
+        }
+        inline void enableInterrupt(uint8_t pin, uint8_t type) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->enableInterrupt(s, pin, type);
+        }
+        inline void disableInterrupt(uint8_t pin) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->disableInterrupt(s, pin);
+        }
+        inline uint16_t getInterruptMask() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->getInterruptMask(s) : 0;
+        }
+        inline void setInterruptMask(uint16_t mask) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->setInterruptMask(s, mask);
+        }
+        inline void setMirror(boolean m) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->setIOCON(s, 6, m);
+        }
+        inline uint16_t getInterruptPins() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readPair(s, MCP23S17Bus::MCP_INTFA) : 0;
+        }
+        inline uint16_t getInterruptValue() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readPair(s, MCP23S17Bus::MCP_INTCAPA) : 0;
+        }
+        inline void setInterruptLevel(uint8_t level) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->setIOCON(s, 1, level != LOW);
+        }
+        inline void setInterruptOD(boolean openDrain) {
+            uint8_t *s = slot();
+            if (s != NULL) _bus->setIOCON(s, 2, openDrain);
+        }
+        inline uint8_t getInterruptAPins() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readRegister(s, MCP23S17Bus::MCP_INTFA) : 0;
+        }
+        inline uint8_t getInterruptAValue() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readRegister(s, MCP23S17Bus::MCP_INTCAPA) : 0;
+        }
+        inline uint8_t getInterruptBPins() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readRegister(s, MCP23S17Bus::MCP_INTFB) : 0;
+        }
+        inline uint8_t getInterruptBValue() {
+            uint8_t *s = slot();
+            return (s != NULL) ? _bus->readRegister(s, MCP23S17Bus::MCP_INTCAPB) : 0;
+        }
 };
 #endif
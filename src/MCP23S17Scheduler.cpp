@@ -0,0 +1,427 @@
+/*
+ * Copyright (c) , Majenko Technologies
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ * 
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ * 
+ *  3. Neither the name of Majenko Technologies nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without 
+ *     specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <MCP23S17Scheduler.h>
+
+/*! The scheduler services the inputs of one MCP23S17 chip.  At low event rates it
+ *  works from the chip's INT pin: the host ISR calls handleInterrupt() and the
+ *  port is only read when something has changed.  When the measured event rate
+ *  rises to the high threshold the chip's interrupts are switched off and the port
+ *  is polled at a fixed rate instead, so a busy input no longer causes an ISR
+ *  entry and SPI transfer for every edge.  Once the rate falls to the low threshold
+ *  the interrupts are switched back on.
+ *
+ *  The constructor takes a pointer to the MCP23S17 or MCP23S17Chip object to service.
+ *
+ *  Example:
+ *
+ *      MCP23S17 myExpander(&SPI, 10, 0);
+ *      MCP23S17Scheduler myInputs(&myExpander);
+ */
+MCP23S17Scheduler::MCP23S17Scheduler(MCP23S17 *chip) {
+    _chip = chip;
+    _busChip = NULL;
+    _callback = NULL;
+    _mask = 0;
+    _value = 0;
+    _polling = false;
+    _pending = false;
+    _irqTime = 0;
+    _window = 100;
+    _highRate = 20;
+    _lowRate = 5;
+    _pollInterval = 1000;
+    _windowStart = 0;
+    _windowEvents = 0;
+    _lastPoll = 0;
+    _polledAt = 0;
+    _rate = 0;
+    clearStats();
+}
+
+MCP23S17Scheduler::MCP23S17Scheduler(MCP23S17 &chip) : MCP23S17Scheduler(&chip) {
+}
+
+MCP23S17Scheduler::MCP23S17Scheduler(MCP23S17Chip *chip) : MCP23S17Scheduler((MCP23S17 *)NULL) {
+    _busChip = chip;
+}
+
+MCP23S17Scheduler::MCP23S17Scheduler(MCP23S17Chip &chip) : MCP23S17Scheduler(&chip) {
+}
+
+/*! This starts the scheduler.  It should be called after the chip has been set up
+ *  and the interrupts of the pins to watch have been enabled with enableInterrupt,
+ *  since those pins are the ones the scheduler watches.  The parameter is a function
+ *  to call whenever a watched pin changes.  It is passed the current value of the
+ *  whole port and a bitmap of the watched pins that have changed.
+ *
+ *  Example:
+ *
+ *      void inputChanged(uint16_t value, uint16_t changed) {
+ *          ...
+ *      }
+ *
+ *      myInputs.begin(inputChanged);
+ */
+void MCP23S17Scheduler::begin(void (*cb)(uint16_t value, uint16_t changed)) {
+    _callback = cb;
+    _mask = getInterruptMask();
+    _polling = false;
+    _value = readPort();
+    _reads++;
+    noInterrupts();
+    _pending = false;
+    interrupts();
+    _windowStart = micros();
+    _windowEvents = 0;
+}
+
+/*! This sets the event rates at which the scheduler switches modes, as a number of
+ *  changes delivered to the callback per measurement window.  When the rate reaches
+ *  *high* it changes to polling, and when it drops to *low* it returns to using
+ *  interrupts.  *low* should be well below *high* to stop the scheduler flapping
+ *  between the two.  The defaults are 20 and 5.
+ *
+ *  The same measure is used in both modes, so interrupts that find no change (an
+ *  input that has already changed back, or a level held against DEFVAL) do not count
+ *  towards a switch.  Polling can deliver at most one change per poll, so if *low*
+ *  is not below the number of polls in a window it is reduced to one less than it.
+ *  While polling, the window is stretched to at least one poll interval.  The
+ *  choice of poll interval therefore cannot force an early return to interrupts.
+ *
+ *  Example:
+ *
+ *      myInputs.setThresholds(50, 10);
+ */
+void MCP23S17Scheduler::setThresholds(uint16_t high, uint16_t low) {
+    _highRate = high;
+    _lowRate = low;
+}
+
+/*! This sets the length of the window, in milliseconds, over which the event rate
+ *  is measured.  The default is 100ms.
+ *
+ *  Example:
+ *
+ *      myInputs.setWindow(250);
+ */
+void MCP23S17Scheduler::setWindow(uint16_t ms) {
+    _window = ms;
+}
+
+/*! This sets the time, in microseconds, between reads of the port while in polling
+ *  mode.  This is also the worst case latency in that mode.  The default is 1000us.
+ *  See setThresholds for how this limits the low threshold.
+ *
+ *  Example:
+ *
+ *      myInputs.setPollInterval(500);
+ */
+void MCP23S17Scheduler::setPollInterval(uint32_t us) {
+    _pollInterval = (us > 0) ? us : 1;
+}
+
+/*! This must be called from the host's interrupt routine attached to the chip's INT
+ *  pin.  It only records that an interrupt happened and when; the chip itself is read
+ *  later by update(), so no SPI traffic happens inside the ISR.
+ *
+ *  Example:
+ *
+ *      void expanderISR() {
+ *          myInputs.handleInterrupt();
+ *      }
+ */
+void MCP23S17Scheduler::handleInterrupt() {
+    if (!_pending) {
+        _irqTime = micros();
+        _pending = true;
+    }
+}
+
+/*! These private functions pass the port and interrupt mask accesses on to
+ *  whichever kind of chip the scheduler was created for.
+ */
+uint16_t MCP23S17Scheduler::readPort() {
+    return (_chip != NULL) ? _chip->readPort() : _busChip->readPort();
+}
+
+uint16_t MCP23S17Scheduler::getInterruptMask() {
+    return (_chip != NULL) ? _chip->getInterruptMask() : _busChip->getInterruptMask();
+}
+
+void MCP23S17Scheduler::setInterruptMask(uint16_t mask) {
+    if (_chip != NULL) {
+        _chip->setInterruptMask(mask);
+    } else {
+        _busChip->setInterruptMask(mask);
+    }
+}
+
+/*! This private function reads the port and, if any watched pins have changed,
+ *  passes the new value to the callback.  It returns true if there was a change.
+ */
+boolean MCP23S17Scheduler::service() {
+    uint16_t value = readPort();
+    _reads++;
+    uint16_t changed = (value ^ _value) & _mask;
+    _value = value;
+    if (changed == 0) {
+        return false;
+    }
+    _events++;
+    _windowEvents++;
+    if (_callback != NULL) {
+        _callback(value, changed);
+    }
+    return true;
+}
+
+/*! This private function reads the port in polling mode, recording the time since
+ *  the previous poll - the longest a change could have waited to be seen.
+ */
+void MCP23S17Scheduler::poll(uint32_t now) {
+    uint32_t gap = now - _polledAt;
+    _polledAt = now;
+    if (gap > _maxPollGap) {
+        _maxPollGap = gap;
+    }
+    service();
+}
+
+/*! This private function closes the current rate window once it has expired and
+ *  switches between interrupt and polling modes as the measured rate demands.
+ */
+void MCP23S17Scheduler::checkRate(uint32_t now) {
+    uint32_t window = (uint32_t)_window * 1000UL;
+    if (_polling && (window < _pollInterval)) {
+        window = _pollInterval;
+    }
+    if ((now - _windowStart) < window) {
+        return;
+    }
+
+    // Polling can see at most one change per poll, so the low threshold has to be
+    // below the number of polls in a window or polling would always end.
+    uint32_t polls = window / _pollInterval;
+    uint16_t low = _lowRate;
+    if (low >= polls) {
+        low = (polls > 0) ? (polls - 1) : 0;
+    }
+
+    _rate = _windowEvents;
+
+    if (!_polling && (_windowEvents >= _highRate)) {
+        setInterruptMask(0);
+        noInterrupts();
+        _pending = false;
+        interrupts();
+        _polling = true;
+        _lastPoll = now - _pollInterval;
+        _polledAt = now;
+        _switches++;
+    } else if (_polling && (_windowEvents <= low)) {
+        setInterruptMask(_mask);
+        noInterrupts();
+        _pending = false;
+        interrupts();
+        _polling = false;
+        _switches++;
+        // Reading the port clears any interrupt that is already waiting and picks up
+        // changes made since the last poll.
+        poll(now);
+    }
+
+    _windowStart = now;
+    _windowEvents = 0;
+}
+
+/*! This should be called as often as possible from loop().  It services any
+ *  interrupt recorded by handleInterrupt() or, in polling mode, reads the port
+ *  whenever the poll interval has passed, and then checks whether the mode needs
+ *  to change.
+ *
+ *  Example:
+ *
+ *      void loop() {
+ *          myInputs.update();
+ *      }
+ */
+void MCP23S17Scheduler::update() {
+    uint32_t now = micros();
+
+    if (_polling) {
+        if ((now - _lastPoll) >= _pollInterval) {
+            _lastPoll += _pollInterval;
+            if ((now - _lastPoll) >= _pollInterval) {
+                // We have fallen behind - don't try to catch up with a burst of reads.
+                _lastPoll = now;
+            }
+            poll(now);
+        }
+    } else if (_pending) {
+        noInterrupts();
+        uint32_t stamp = _irqTime;
+        _pending = false;
+        interrupts();
+        uint32_t latency = micros() - stamp;
+        if (service()) {
+            _latencySum += latency;
+            _latencyCount++;
+            if (latency > _maxLatency) {
+                _maxLatency = latency;
+            }
+        }
+    }
+
+    checkRate(now);
+}
+
+/*! This returns true while the scheduler is polling the port, or false while
+ *  it is working from interrupts.
+ *
+ *  Example:
+ *
+ *      boolean busy = myInputs.isPolling();
+ */
+boolean MCP23S17Scheduler::isPolling() {
+    return _polling;
+}
+
+/*! This returns the value of the port as last read by the scheduler.
+ *
+ *  Example:
+ *
+ *      unsigned int value = myInputs.getValue();
+ */
+uint16_t MCP23S17Scheduler::getValue() {
+    return _value;
+}
+
+/*! This returns the number of times a change of the watched pins has been passed to
+ *  the callback since the statistics were last cleared.
+ *
+ *  Example:
+ *
+ *      unsigned long events = myInputs.getEventCount();
+ */
+uint32_t MCP23S17Scheduler::getEventCount() {
+    return _events;
+}
+
+/*! This returns the number of SPI transfers the scheduler has made to read the
+ *  port since the statistics were last cleared.  Each transfer reads both ports.
+ *  Compared with getEventCount it shows how much bus time each delivered event is
+ *  costing.
+ *
+ *  Example:
+ *
+ *      unsigned long reads = myInputs.getReadCount();
+ */
+uint32_t MCP23S17Scheduler::getReadCount() {
+    return _reads;
+}
+
+/*! This returns the longest latency, in microseconds, of any change delivered to
+ *  the callback in interrupt mode: the time between the interrupt arriving and
+ *  update() servicing it.  Changes found while polling are not included, as the
+ *  time they happened is not known; see getMaxPollGap for that mode.
+ *
+ *  Example:
+ *
+ *      unsigned long worst = myInputs.getMaxLatency();
+ */
+uint32_t MCP23S17Scheduler::getMaxLatency() {
+    return _maxLatency;
+}
+
+/*! This returns the average latency, in microseconds, of the changes delivered to
+ *  the callback in interrupt mode, measured as for getMaxLatency.
+ *
+ *  Example:
+ *
+ *      unsigned long average = myInputs.getAverageLatency();
+ */
+uint32_t MCP23S17Scheduler::getAverageLatency() {
+    if (_latencyCount == 0) {
+        return 0;
+    }
+    return _latencySum / _latencyCount;
+}
+
+/*! This returns the longest time, in microseconds, between two reads of the port
+ *  in polling mode.  A change can have waited up to this long before being seen,
+ *  so it is the worst case latency while polling.  It will be somewhat more than
+ *  the poll interval if update() is not called often enough.
+ *
+ *  Example:
+ *
+ *      unsigned long worst = myInputs.getMaxPollGap();
+ */
+uint32_t MCP23S17Scheduler::getMaxPollGap() {
+    return _maxPollGap;
+}
+
+/*! This returns the number of events delivered to the callback during the last
+ *  complete measurement window - the current throughput in events per window.
+ *
+ *  Example:
+ *
+ *      unsigned int rate = myInputs.getEventRate();
+ */
+uint16_t MCP23S17Scheduler::getEventRate() {
+    return _rate;
+}
+
+/*! This returns the number of times the scheduler has switched between interrupt
+ *  and polling modes.
+ *
+ *  Example:
+ *
+ *      unsigned int switches = myInputs.getModeSwitches();
+ */
+uint16_t MCP23S17Scheduler::getModeSwitches() {
+    return _switches;
+}
+
+/*! This resets all the statistics counters to zero.
+ *
+ *  Example:
+ *
+ *      myInputs.clearStats();
+ */
+void MCP23S17Scheduler::clearStats() {
+    _events = 0;
+    _reads = 0;
+    _latencySum = 0;
+    _latencyCount = 0;
+    _maxLatency = 0;
+    _maxPollGap = 0;
+    _switches = 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Copyright (c) , Majenko Technologies
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without modification, 
+ * are permitted provided that the following conditions are met:
+ * 
+ *  1. Redistributions of source code must retain the above copyright notice, 
+ *     this list of conditions and the following disclaimer.
+ * 
+ *  2. Redistributions in binary form must reproduce the above copyright notice,
+ *     this list of conditions and the following disclaimer in the documentation
+ *      and/or other materials provided with the distribution.
+ * 
+ *  3. Neither the name of Majenko Technologies nor the names of its contributors may be used
+ *     to endorse or promote products derived from this software without 
+ *     specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" 
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE 
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE 
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE 
+ * FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL 
+ * DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR 
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER 
+ * CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, 
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE 
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef _MCP23S17_SCHEDULER_H
+#define _MCP23S17_SCHEDULER_H
+
+#include <MCP23S17.h>
+
+class MCP23S17Scheduler {
+    private:
+        MCP23S17 *_chip;    /*! The chip whose inputs are being serviced */
+        MCP23S17Chip *_busChip; /*! Or the pooled chip whose inputs are being serviced */
+        void (*_callback)(uint16_t value, uint16_t changed); /*! Called when a watched input changes */
+
+        uint16_t _mask;     /*! Watched pins - the interrupt-enabled pins at the time of begin() */
+        uint16_t _value;    /*! Last known state of the port pins */
+        boolean _polling;   /*! True while in burst polling mode */
+
+        volatile boolean _pending;      /*! Set by handleInterrupt(), cleared when serviced */
+        volatile uint32_t _irqTime;     /*! micros() at the first unserviced interrupt */
+
+        uint16_t _window;       /*! Length of the rate measurement window in ms */
+        uint16_t _highRate;     /*! Changes per window at or above which polling starts */
+        uint16_t _lowRate;      /*! Changes per window at or below which interrupts resume */
+        uint32_t _pollInterval; /*! Time between polls in microseconds */
+
+        uint32_t _windowStart;  /*! micros() at the start of the current rate window */
+        uint16_t _windowEvents; /*! Events delivered in the current rate window */
+        uint16_t _rate;         /*! Events delivered in the last complete rate window */
+        uint32_t _lastPoll;     /*! Scheduled time of the last poll */
+        uint32_t _polledAt;     /*! micros() when the port was last actually polled */
+
+        uint32_t _events;       /*! Total changes delivered to the callback */
+        uint32_t _reads;        /*! Total SPI transfers made to read the port */
+        uint32_t _latencySum;   /*! Sum of interrupt mode event latencies in microseconds */
+        uint32_t _latencyCount; /*! Number of latencies in _latencySum */
+        uint32_t _maxLatency;   /*! Worst interrupt mode event latency in microseconds */
+        uint32_t _maxPollGap;   /*! Longest time between polls in microseconds */
+        uint16_t _switches;     /*! Number of times the mode has changed */
+
+        uint16_t readPort();
+        uint16_t getInterruptMask();
+        void setInterruptMask(uint16_t mask);
+        boolean service();
+        void poll(uint32_t now);
+        void checkRate(uint32_t now);
+
+    public:
+        MCP23S17Scheduler(MCP23S17 *chip);
+        MCP23S17Scheduler(MCP23S17 &chip);
+        MCP23S17Scheduler(MCP23S17Chip *chip);
+        MCP23S17Scheduler(MCP23S17Chip &chip);
+
+        void begin(void (*cb)(uint16_t value, uint16_t changed));
+        void setThresholds(uint16_t high, uint16_t low);
+        void setWindow(uint16_t ms);
+        void setPollInterval(uint32_t us);
+
+        void handleInterrupt();
+        void update();
+
+        boolean isPolling();
+        uint16_t getValue();
+        uint32_t getEventCount();
+        uint32_t getReadCount();
+        uint32_t getMaxLatency();
+        uint32_t getAverageLatency();
+        uint32_t getMaxPollGap();
+        uint16_t getEventRate();
+        uint16_t getModeSwitches();
+        void clearStats();
+};
+#endif